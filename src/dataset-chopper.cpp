@@ -10,6 +10,10 @@
 #include <experimental/filesystem>
 #include <random>
 
+// Local includes
+#include "dataset-io.hpp"
+#include "dataset-metrics.hpp"
+
 // Defines
 #define VERBOSE false
 #define EXPORT_RANDOM false
@@ -22,7 +26,7 @@ void fetch_image_paths(std::string path, std::vector<std::string> &image_paths)
 
     // Generate vector of paths to supported files
     image_paths.clear();
-    std::vector<std::string> supported_file_extensions = {"jpg", "png"};
+    std::vector<std::string> supported_file_extensions = {"jpg", "png", "tif", "tiff"};
     for (const auto & entry : std::experimental::filesystem::directory_iterator(path))
     {
         std::string path_string = entry.path();
@@ -42,50 +46,6 @@ void fetch_image_paths(std::string path, std::vector<std::string> &image_paths)
         std::cout << "Found " << image_paths.size() << " image(s)!" << std::endl;
 }
 
-cv::Mat threshold(const cv::Mat &image_src, int threshold = 80)
-{
-    cv::Mat image_grey, image_dst;
-    image_dst = image_src.clone();
-    cv::cvtColor(image_src, image_grey, CV_BGR2GRAY);
-
-    for(int row = 0; row < image_src.rows; row++)
-    {
-        for(int col = 0; col < image_src.cols; col++)
-        {
-            int pixel_intensity = image_grey.at<uchar>(row,col);
-            if(pixel_intensity < threshold)
-            {
-                cv::Vec3b &color = image_dst.at<cv::Vec3b>(row,col);
-                color[0] = 0;
-                color[1] = 0;
-                color[2] = 0;
-            }
-        }
-    }
-
-    return image_dst;
-}
-
-bool is_filled(const cv::Mat &image_src)
-{
-    cv::Mat image_grey;
-    cv::cvtColor(image_src, image_grey, CV_BGR2GRAY);
-
-    for(int row = 0; row < image_src.rows; row++)
-    {
-        for(int col = 0; col < image_src.cols; col++)
-        {
-            int pixel_intensity = image_grey.at<uchar>(row,col);
-            if(pixel_intensity == 0)
-            {
-                return false;
-            }
-        }
-    }
-
-    return true;
-}
-
 void chop_image(const cv::Mat &image, std::vector<cv::Mat> &sub_images, int width, int height)
 {
 
@@ -136,12 +96,22 @@ int main(int argc, char *argv[])
         fetch_image_paths(path_string,image_paths);
         std::sort(image_paths.begin(), image_paths.end());
 
+        std::vector<std::vector<uchar>> image_batch;
+        std::vector<std::string> export_names;
+        std::vector<std::vector<uchar>> export_buffers;
 
         for(int i = 0; i < image_paths.size(); i++)
         {
             //int slash_index_file = image_paths[i].find_last_of("\\/")+1;
             //std::cout << image_paths[i].substr(slash_index_file,image_paths[i].length()-slash_index_dir) << std::endl;
-            cv::Mat image = cv::imread(image_paths[i], cv::IMREAD_COLOR );
+            if(!(i%IO_BATCH))
+            {
+                // Read the next batch of files with many requests in flight
+                int batch_end = std::min<int>(i+IO_BATCH, image_paths.size());
+                std::vector<std::string> batch_paths(image_paths.begin()+i, image_paths.begin()+batch_end);
+                read_files(batch_paths, image_batch, io_depth());
+            }
+            cv::Mat image = decode_image(image_batch[i%IO_BATCH], decode_flags(image_paths[i]));
             if(VERBOSE)
                 std::cout << image_paths[i] << std::endl;
 
@@ -168,7 +138,9 @@ int main(int argc, char *argv[])
                     char index_padded[25];
                     sprintf(index_padded, "%05d", export_index);
                     std::string image_name = category_dir_chopped+"/image_"+index_padded+".png";
-                    cv::imwrite(image_name, sub_images[index]);
+                    export_names.push_back(image_name);
+                    export_buffers.emplace_back();
+                    encode_image(image_name, sub_images[index], export_buffers.back());
 
                     sub_images.erase(sub_images.begin() + index);
                     export_index++;
@@ -186,10 +158,20 @@ int main(int argc, char *argv[])
                     sprintf(index_padded, "%05d", export_index);
 
                     std::string image_name = category_dir_chopped+"/image_"+index_padded+".png";
-                    cv::imwrite(image_name, sub_images[i]);
+                    export_names.push_back(image_name);
+                    export_buffers.emplace_back();
+                    encode_image(image_name, sub_images[i], export_buffers.back());
                     export_index++;
                 }
             }
+
+            // Write outputs in batches
+            if(export_names.size() >= IO_BATCH || i+1 == image_paths.size())
+            {
+                write_files(export_names, export_buffers, io_depth());
+                export_names.clear();
+                export_buffers.clear();
+            }
         }
     }
 
@@ -9,13 +9,17 @@
 #include <regex>
 #include <experimental/filesystem>
 
+// Local includes
+#include "dataset-io.hpp"
+#include "dataset-metrics.hpp"
+
 void fetch_image_paths(std::string path, std::vector<std::string> &image_paths)
 {
     std::cout << "Dataset path \"" << path << "\"..." << std::endl;
 
     // Generate vector of paths to supported files
     image_paths.clear();
-    std::vector<std::string> supported_file_extensions = {"jpg", "png"};
+    std::vector<std::string> supported_file_extensions = {"jpg", "png", "tif", "tiff"};
     for (const auto & entry : std::experimental::filesystem::directory_iterator(path))
     {
         std::string path_string = entry.path();
@@ -33,18 +37,17 @@ void fetch_image_paths(std::string path, std::vector<std::string> &image_paths)
     std::cout << "Found " << image_paths.size() << " image(s)!" << std::endl;
 }
 
-cv::Mat crop_image(cv::Mat image)
+// Bounding box of all non-black pixels, as {min_col, min_row, max_col, max_row}
+template<typename T, int CN>
+cv::Vec4i bounding_box_kernel(const cv::Mat &image)
 {
-    cv::Mat image_grey;
-    cv::cvtColor(image, image_grey, CV_BGR2GRAY);
-
     int min_row = image.rows, max_row = 0, min_col = image.cols, max_col = 0;
     for(int row = 0; row < image.rows; row++)
     {
-        for(int col = 0; col < image.cols; col++)
+        const T *pixel = image.ptr<T>(row);
+        for(int col = 0; col < image.cols; col++, pixel += CN)
         {
-            int pixel = image_grey.at<uchar>(row,col);
-            if(pixel != 0)
+            if(grey_value<T,CN>(pixel) != 0)
             {
                 if(row < min_row)
                     min_row = row;
@@ -58,6 +61,18 @@ cv::Mat crop_image(cv::Mat image)
         }
     }
 
+    return cv::Vec4i(min_col, min_row, max_col, max_row);
+}
+
+cv::Mat crop_image(cv::Mat image)
+{
+    cv::Vec4i bounds = dispatch_pixels(image, [](const cv::Mat &image, auto format)
+    {
+        typedef decltype(format) F;
+        return bounding_box_kernel<typename F::type, F::channels>(image);
+    });
+    int min_col = bounds[0], min_row = bounds[1], max_col = bounds[2], max_row = bounds[3];
+
     if(min_row == image.rows || max_row == 0 || min_col == image.cols || max_col == 0)
         std::cout << "This image is empty" << std::endl;
 
@@ -141,23 +156,33 @@ int main(int argc, char *argv[])
         fetch_image_paths(path_string,image_paths);
         std::sort(image_paths.begin(), image_paths.end());
 
+        std::vector<std::vector<uchar>> image_batch;
 
         for(int i = 0; i < image_paths.size(); i++)
         {
             //int slash_index_file = image_paths[i].find_last_of("\\/")+1;
             //std::cout << image_paths[i].substr(slash_index_file,image_paths[i].length()-slash_index_dir) << std::endl;
-            cv::Mat image = cv::imread(image_paths[i], cv::IMREAD_COLOR );
+            if(!(i%IO_BATCH))
+            {
+                // Read the next batch of files with many requests in flight
+                int batch_end = std::min<int>(i+IO_BATCH, image_paths.size());
+                std::vector<std::string> batch_paths(image_paths.begin()+i, image_paths.begin()+batch_end);
+                read_files(batch_paths, image_batch, io_depth());
+            }
+            cv::Mat image = decode_image(image_batch[i%IO_BATCH], decode_flags(image_paths[i]));
             std::cout << image_paths[i] << std::endl;
             cv::Mat image_cropped = crop_image(image);
 
             char index_padded[25];
             sprintf(index_padded, "%05d", export_index);
 
-            cv::imshow("Test", image_cropped);
-            cv::waitKey(0);
+            // Write before waiting so quitting keeps every viewed crop
             std::string image_name = category_dir_cropped+"/image_"+index_padded+".png";
             cv::imwrite(image_name, image_cropped);
 
+            cv::imshow("Test", image_cropped);
+            cv::waitKey(0);
+
             export_index++;
         }
     }
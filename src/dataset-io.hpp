@@ -0,0 +1,414 @@
+#ifndef DATASET_IO_HPP
+#define DATASET_IO_HPP
+
+// OpenCV includes
+#include <opencv2/opencv.hpp>
+#include <opencv2/core.hpp>
+
+// Standard includes
+#include <vector>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+// System includes
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+// Defines
+#ifndef IO_DEPTH
+#define IO_DEPTH 32     // Requests in flight (default for DATASET_IO_DEPTH)
+#endif
+#ifndef IO_BATCH
+#define IO_BATCH 500    // Files per batch (multiple of 20 for the selector)
+#endif
+
+/*
+ * Bulk file I/O for many small images.
+ *
+ * Whole files are read into memory (and written from memory) with up to
+ * io_depth() files in flight, so the device sees a real queue instead of one
+ * blocking open/read/close at a time. io_uring is used when the tools are
+ * built against liburing and the kernel supports the needed operations;
+ * otherwise a pool of threads issuing open/pread/pwrite is used. Failed
+ * files leave an empty buffer, which decode_image turns into an empty
+ * cv::Mat just like cv::imread would.
+ *
+ * Only compressed bytes are held for a whole batch: callers decode each
+ * buffer when they reach it and encode outputs as soon as they are made.
+ */
+
+// Stages of one file on the io_uring path
+enum io_stage { IO_OPEN, IO_STAT, IO_TRANSFER, IO_CLOSE };
+
+struct io_request
+{
+    int fd = -1;
+    size_t index = 0;
+    size_t offset = 0;
+    int stage = IO_OPEN;
+#ifdef HAVE_LIBURING
+    struct statx file_stat;
+#endif
+};
+
+inline void io_report_error(const std::string &path, int error)
+{
+    std::cout << "I/O error on \"" << path << "\": " << std::strerror(error) << std::endl;
+}
+
+// Open a file for reading and size its buffer. Returns -1 on failure.
+inline int io_open_read(const std::string &path, std::vector<uchar> &buffer)
+{
+    buffer.clear();
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        io_report_error(path, errno);
+        return -1;
+    }
+
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) < 0)
+    {
+        io_report_error(path, errno);
+        close(fd);
+        return -1;
+    }
+
+    buffer.resize(file_stat.st_size);
+    return fd;
+}
+
+inline int io_open_write(const std::string &path)
+{
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0)
+        io_report_error(path, errno);
+    return fd;
+}
+
+inline void io_transfer_threaded(const std::vector<std::string> &paths, std::vector<std::vector<uchar>> &buffers, const std::vector<size_t> &indices, bool write_mode, int depth)
+{
+    std::atomic<size_t> next(0);
+    auto worker = [&]()
+    {
+        for(size_t n = next++; n < indices.size(); n = next++)
+        {
+            size_t i = indices[n];
+            std::vector<uchar> &buffer = buffers[i];
+            int fd = write_mode ? io_open_write(paths[i]) : io_open_read(paths[i], buffer);
+            if(fd < 0)
+                continue;
+
+            size_t offset = 0;
+            while(offset < buffer.size())
+            {
+                ssize_t result = write_mode
+                    ? pwrite(fd, buffer.data() + offset, buffer.size() - offset, offset)
+                    : pread(fd, buffer.data() + offset, buffer.size() - offset, offset);
+                if(result < 0 && errno == EINTR)
+                    continue;
+                if(result <= 0)
+                {
+                    io_report_error(paths[i], result < 0 ? errno : EIO);
+                    if(!write_mode)
+                        buffer.clear();
+                    break;
+                }
+                offset += result;
+            }
+            close(fd);
+        }
+    };
+
+    int thread_count = std::min<size_t>(std::max(depth, 1), indices.size());
+    std::vector<std::thread> threads;
+    for(int i = 0; i < thread_count; i++)
+        threads.emplace_back(worker);
+    for(auto &thread : threads)
+        thread.join();
+}
+
+#ifdef HAVE_LIBURING
+// Queue the current stage of a request
+inline void io_prep_request(io_uring &ring, io_request &request, const std::string &path, std::vector<uchar> &buffer, bool write_mode)
+{
+    io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+    switch(request.stage)
+    {
+    case IO_OPEN:
+        if(write_mode)
+            io_uring_prep_openat(sqe, AT_FDCWD, path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        else
+            io_uring_prep_openat(sqe, AT_FDCWD, path.c_str(), O_RDONLY | O_CLOEXEC, 0);
+        break;
+    case IO_STAT:
+        io_uring_prep_statx(sqe, request.fd, "", AT_EMPTY_PATH, STATX_SIZE, &request.file_stat);
+        break;
+    case IO_TRANSFER:
+        if(write_mode)
+            io_uring_prep_write(sqe, request.fd, buffer.data() + request.offset, buffer.size() - request.offset, request.offset);
+        else
+            io_uring_prep_read(sqe, request.fd, buffer.data() + request.offset, buffer.size() - request.offset, request.offset);
+        break;
+    case IO_CLOSE:
+        io_uring_prep_close(sqe, request.fd);
+        break;
+    }
+    io_uring_sqe_set_data(sqe, &request);
+}
+
+// Advance a request after its stage completed. Returns true when the file is done.
+inline bool io_complete_request(io_request &request, int res, const std::string &path, std::vector<uchar> &buffer, bool write_mode)
+{
+    switch(request.stage)
+    {
+    case IO_OPEN:
+        if(res < 0)
+        {
+            io_report_error(path, -res);
+            return true;
+        }
+        request.fd = res;
+        request.stage = write_mode ? IO_TRANSFER : IO_STAT;
+        return false;
+    case IO_STAT:
+        if(res < 0)
+            io_report_error(path, -res);
+        else
+            buffer.resize(request.file_stat.stx_size);
+        request.stage = buffer.empty() ? IO_CLOSE : IO_TRANSFER;
+        return false;
+    case IO_TRANSFER:
+        if(res <= 0)
+        {
+            io_report_error(path, res < 0 ? -res : EIO);
+            if(!write_mode)
+                buffer.clear();
+            request.stage = IO_CLOSE;
+            return false;
+        }
+
+        // Short transfers queue the remainder
+        request.offset += res;
+        if(request.offset >= buffer.size())
+            request.stage = IO_CLOSE;
+        return false;
+    default:
+        if(res < 0)
+            io_report_error(path, -res);
+        request.fd = -1;
+        return true;
+    }
+}
+
+inline bool io_uring_supported(io_uring &ring)
+{
+    io_uring_probe *probe = io_uring_get_probe_ring(&ring);
+    if(!probe)
+        return false;
+
+    bool supported = true;
+    for(int opcode : {IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE})
+        supported = supported && io_uring_opcode_supported(probe, opcode);
+
+    io_uring_free_probe(probe);
+    return supported;
+}
+
+/*
+ * Every step of a file (openat, statx, read/write, close) goes through the
+ * ring, so metadata round trips overlap as well as the transfers. Each file
+ * has one request queued at a time, so depth files are in flight. On return
+ * indices holds the files the caller still has to transfer: all of them if
+ * the ring is unavailable, the unfinished ones if submission failed.
+ */
+inline void io_transfer_uring(const std::vector<std::string> &paths, std::vector<std::vector<uchar>> &buffers, std::vector<size_t> &indices, bool write_mode, int depth)
+{
+    io_uring ring;
+    if(io_uring_queue_init(depth, &ring, 0) < 0)
+        return;
+    if(!io_uring_supported(ring))
+    {
+        io_uring_queue_exit(&ring);
+        return;
+    }
+
+    std::vector<io_request> requests(indices.size());
+    std::vector<bool> done(indices.size(), false);
+    size_t next = 0;
+    int in_flight = 0;
+    bool failed = false;
+    while(!failed && (next < indices.size() || in_flight > 0))
+    {
+        // Fill the queue with new files
+        while(in_flight < depth && next < indices.size())
+        {
+            io_request &request = requests[next];
+            request.index = indices[next++];
+            io_prep_request(ring, request, paths[request.index], buffers[request.index], write_mode);
+            in_flight++;
+        }
+
+        // Submit the whole batch and reap everything that completed
+        int result = io_uring_submit_and_wait(&ring, 1);
+        if(result < 0 && result != -EINTR)
+        {
+            std::cout << "io_uring submission failed: " << std::strerror(-result) << std::endl;
+            failed = true;
+        }
+
+        io_uring_cqe *cqe;
+        while(true)
+        {
+            // After a failure, wait for every request the kernel already holds
+            // (the unsubmitted ones stay in the submission queue and never run)
+            if(failed)
+            {
+                if(in_flight - int(io_uring_sq_ready(&ring)) <= 0)
+                    break;
+                result = io_uring_wait_cqe(&ring, &cqe);
+                if(result == -EINTR)
+                    continue;
+                if(result < 0)
+                {
+                    std::cout << "io_uring wait failed: " << std::strerror(-result) << std::endl;
+                    break;
+                }
+            }
+            else if(io_uring_peek_cqe(&ring, &cqe) != 0)
+                break;
+
+            io_request &request = *static_cast<io_request*>(io_uring_cqe_get_data(cqe));
+            const std::string &path = paths[request.index];
+            std::vector<uchar> &buffer = buffers[request.index];
+            int res = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+            size_t slot = &request - requests.data();
+
+            bool retry = (res == -EINTR || res == -EAGAIN);
+            if(!retry && io_complete_request(request, res, path, buffer, write_mode))
+            {
+                done[slot] = true;
+                in_flight--;
+            }
+            else if(failed)
+                in_flight--;
+            else
+                io_prep_request(ring, request, path, buffer, write_mode);
+        }
+    }
+
+    io_uring_queue_exit(&ring);
+
+    // Hand unfinished files back. Nothing in the kernel refers to them any
+    // more, so their descriptors are closed here exactly once.
+    std::vector<size_t> remaining(indices.begin()+next, indices.end());
+    for(size_t slot = 0; slot < next; slot++)
+    {
+        io_request &request = requests[slot];
+        if(done[slot])
+            continue;
+        if(request.fd >= 0)
+            close(request.fd);
+        if(request.stage != IO_CLOSE)
+            remaining.push_back(request.index);
+    }
+    indices.swap(remaining);
+}
+#endif
+
+inline void io_transfer(const std::vector<std::string> &paths, std::vector<std::vector<uchar>> &buffers, bool write_mode, int depth)
+{
+    // Outputs that failed to encode are skipped rather than written as empty files
+    std::vector<size_t> indices;
+    for(size_t i = 0; i < paths.size(); i++)
+        if(!write_mode || !buffers[i].empty())
+            indices.push_back(i);
+    if(indices.empty())
+        return;
+
+#ifdef HAVE_LIBURING
+    io_transfer_uring(paths, buffers, indices, write_mode, depth);
+    if(indices.empty())
+        return;
+#endif
+
+    io_transfer_threaded(paths, buffers, indices, write_mode, depth);
+}
+
+// Requests in flight: DATASET_IO_DEPTH from the environment, IO_DEPTH otherwise
+inline int io_depth()
+{
+    static const int depth = []()
+    {
+        const char *value = std::getenv("DATASET_IO_DEPTH");
+        if(!value)
+            return IO_DEPTH;
+
+        int parsed = std::atoi(value);
+        if(parsed > 0)
+            return parsed;
+
+        std::cout << "Ignoring invalid DATASET_IO_DEPTH \"" << value << "\"" << std::endl;
+        return IO_DEPTH;
+    }();
+    return depth;
+}
+
+inline void read_files(const std::vector<std::string> &paths, std::vector<std::vector<uchar>> &buffers, int depth = IO_DEPTH)
+{
+    buffers.clear();
+    buffers.resize(paths.size());
+    io_transfer(paths, buffers, false, depth);
+}
+
+inline void write_files(const std::vector<std::string> &paths, std::vector<std::vector<uchar>> &buffers, int depth = IO_DEPTH)
+{
+    io_transfer(paths, buffers, true, depth);
+}
+
+/*
+ * Decode flags keeping alpha and 16-bit depth. PNG and TIFF are decoded
+ * unchanged; everything else (JPEG) uses ANYCOLOR | ANYDEPTH instead, since
+ * OpenCV skips EXIF orientation when the flags are exactly IMREAD_UNCHANGED.
+ */
+inline int decode_flags(const std::string &path)
+{
+    std::string extension = path.substr(path.find_last_of(".") + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    if(extension == "png" || extension == "tif" || extension == "tiff")
+        return cv::IMREAD_UNCHANGED;
+    return cv::IMREAD_ANYCOLOR | cv::IMREAD_ANYDEPTH;
+}
+
+// Decode one buffer from read_files and release its memory (see decode_flags)
+inline cv::Mat decode_image(std::vector<uchar> &buffer, int flags = cv::IMREAD_COLOR)
+{
+    cv::Mat image;
+    if(!buffer.empty())
+        image = cv::imdecode(buffer, flags);
+    std::vector<uchar>().swap(buffer);
+    return image;
+}
+
+// Encode an image for write_files (format taken from the file extension)
+inline void encode_image(const std::string &path, const cv::Mat &image, std::vector<uchar> &buffer)
+{
+    std::string extension = path.substr(path.find_last_of("."));
+    if(!cv::imencode(extension, image, buffer))
+        std::cout << "Could not encode image \"" << path << "\"" << std::endl;
+}
+
+#endif // DATASET_IO_HPP
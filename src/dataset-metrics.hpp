@@ -0,0 +1,352 @@
+#ifndef DATASET_METRICS_HPP
+#define DATASET_METRICS_HPP
+
+// OpenCV includes
+#include <opencv2/opencv.hpp>
+#include <opencv2/core.hpp>
+
+// Standard includes
+#include <vector>
+#include <iostream>
+#include <cstdlib>
+
+// Defines
+#ifndef VERBOSE
+#define VERBOSE false
+#endif
+
+/*
+ * Per-image pixel metrics shared by the selector, chopper and stats tools.
+ *
+ * Images are loaded with cv::IMREAD_UNCHANGED and dispatched once per image
+ * (dispatch_pixels) to a kernel instantiated for the pixel type: 1, 3 or 4
+ * channels of 8 or 16 bit. Grey values are computed inline, so there is no
+ * cvtColor pass, and 16-bit data keeps its full precision. Thresholds are
+ * always given on the 8-bit scale and scaled to the image depth. Pixels with
+ * zero alpha count as background. Other depths (signed, floating point) are
+ * converted once before dispatch.
+ */
+
+template<typename T> struct depth_traits;
+template<> struct depth_traits<uchar>
+{
+    static const int max_value = 255;
+    static const int levels = 256;
+};
+template<> struct depth_traits<ushort>
+{
+    static const int max_value = 65535;
+    static const int levels = 65536;
+};
+
+template<typename T, int CN> struct pixel_format
+{
+    typedef T type;
+    static const int channels = CN;
+};
+
+// Scale a threshold on the 8-bit scale to the depth of T
+template<typename T>
+inline int scale_threshold(int threshold)
+{
+    return threshold*(depth_traits<T>::max_value/255);
+}
+
+// Same fixed-point weights as cv::COLOR_BGR2GRAY
+template<typename T, int CN>
+inline int grey_value(const T *pixel)
+{
+    if(CN == 1)
+        return pixel[0];
+    if(CN == 4 && pixel[3] == 0)
+        return 0;
+    return (pixel[0]*1868 + pixel[1]*9617 + pixel[2]*4899 + (1 << 13)) >> 14;
+}
+
+// Call kernel(image, pixel_format<T,CN>()) for the pixel type of the image
+template<typename Kernel>
+auto dispatch_pixels(const cv::Mat &image, Kernel kernel) -> decltype(kernel(image, pixel_format<uchar,3>()))
+{
+    switch(image.type())
+    {
+    case CV_8UC1:
+        return kernel(image, pixel_format<uchar,1>());
+    case CV_8UC3:
+        return kernel(image, pixel_format<uchar,3>());
+    case CV_8UC4:
+        return kernel(image, pixel_format<uchar,4>());
+    case CV_16UC1:
+        return kernel(image, pixel_format<ushort,1>());
+    case CV_16UC3:
+        return kernel(image, pixel_format<ushort,3>());
+    case CV_16UC4:
+        return kernel(image, pixel_format<ushort,4>());
+    default:
+        break;
+    }
+
+    // Other depths are mapped onto 8/16 bit: signed types clamp negatives to
+    // 0 (so a zero background stays background), floating point is taken as
+    // [0,1] and scaled to 16 bit
+    if(VERBOSE)
+        std::cout << "Converting unsupported pixel type: " << image.type() << std::endl;
+
+    cv::Mat converted;
+    switch(image.depth())
+    {
+    case CV_8S:
+        image.convertTo(converted, CV_8U);
+        break;
+    case CV_16S:
+    case CV_32S:
+        image.convertTo(converted, CV_16U);
+        break;
+#ifdef CV_16F
+    case CV_16F:
+#endif
+    case CV_32F:
+    case CV_64F:
+        image.convertTo(converted, CV_16U, 65535);
+        break;
+    case CV_8U:
+    case CV_16U:
+        converted = image;
+        break;
+    default:
+        std::cout << "Unknown pixel depth " << image.depth() << ", converting without scaling" << std::endl;
+        image.convertTo(converted, CV_8U);
+        break;
+    }
+
+    if(converted.channels() != 1 && converted.channels() != 3 && converted.channels() != 4)
+        cv::extractChannel(converted, converted, 0);
+    return dispatch_pixels(converted, kernel);
+}
+
+template<typename T, int CN>
+cv::Mat threshold_kernel(const cv::Mat &image_src, int threshold)
+{
+    cv::Mat image_dst = image_src.clone();
+    int level = scale_threshold<T>(threshold);
+
+    for(int row = 0; row < image_dst.rows; row++)
+    {
+        T *pixel = image_dst.ptr<T>(row);
+        for(int col = 0; col < image_dst.cols; col++, pixel += CN)
+        {
+            if(grey_value<T,CN>(pixel) < level)
+            {
+                // Keep alpha
+                for(int channel = 0; channel < (CN == 4 ? 3 : CN); channel++)
+                    pixel[channel] = 0;
+            }
+        }
+    }
+
+    return image_dst;
+}
+
+template<typename T, int CN>
+bool is_filled_kernel(const cv::Mat &image_src)
+{
+    for(int row = 0; row < image_src.rows; row++)
+    {
+        const T *pixel = image_src.ptr<T>(row);
+        for(int col = 0; col < image_src.cols; col++, pixel += CN)
+        {
+            if(grey_value<T,CN>(pixel) == 0)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+template<typename T, int CN>
+int occupancy_kernel(const cv::Mat &image_src, int threshold)
+{
+    int level = scale_threshold<T>(threshold);
+
+    int pixels = 0;
+    for(int row = 0; row < image_src.rows; row++)
+    {
+        const T *pixel = image_src.ptr<T>(row);
+        for(int col = 0; col < image_src.cols; col++, pixel += CN)
+            pixels += grey_value<T,CN>(pixel) > level;
+    }
+
+    return pixels;
+}
+
+/*
+ * Lookup table from grey level to 8-bit equalized value, computed the same
+ * way as cv::equalizeHist but over all levels of the image depth. Returns the
+ * grey histogram in hist.
+ */
+template<typename T, int CN>
+void equalize_lut(const cv::Mat &image_src, std::vector<int> &hist, std::vector<uchar> &lut)
+{
+    const int levels = depth_traits<T>::levels;
+    hist.assign(levels, 0);
+    lut.assign(levels, 0);
+
+    for(int row = 0; row < image_src.rows; row++)
+    {
+        const T *pixel = image_src.ptr<T>(row);
+        for(int col = 0; col < image_src.cols; col++, pixel += CN)
+            hist[grey_value<T,CN>(pixel)]++;
+    }
+
+    int total = image_src.rows*image_src.cols;
+    int i = 0;
+    while(i < levels && !hist[i])
+        i++;
+    if(i == levels)
+        return;
+
+    // Single grey level: equalizeHist keeps the value
+    if(hist[i] == total)
+    {
+        lut[i] = cv::saturate_cast<uchar>(i*255.0/depth_traits<T>::max_value);
+        return;
+    }
+
+    float scale = 255.f/(total - hist[i]);
+    int sum = 0;
+    for(lut[i++] = 0; i < levels; i++)
+    {
+        sum += hist[i];
+        lut[i] = cv::saturate_cast<uchar>(sum*scale);
+    }
+}
+
+template<typename T, int CN>
+int64_t lightness_kernel(const cv::Mat &image_src)
+{
+    std::vector<int> hist;
+    std::vector<uchar> lut;
+    equalize_lut<T,CN>(image_src, hist, lut);
+
+    int64_t sum = 0;
+    for(size_t level = 0; level < hist.size(); level++)
+        sum += int64_t(hist[level])*lut[level];
+
+    return sum;
+}
+
+template<typename T, int CN>
+cv::Mat equalized_grey_kernel(const cv::Mat &image_src)
+{
+    std::vector<int> hist;
+    std::vector<uchar> lut;
+    equalize_lut<T,CN>(image_src, hist, lut);
+
+    cv::Mat image_dst(image_src.rows, image_src.cols, CV_8UC1);
+    for(int row = 0; row < image_src.rows; row++)
+    {
+        const T *pixel = image_src.ptr<T>(row);
+        uchar *grey = image_dst.ptr<uchar>(row);
+        for(int col = 0; col < image_src.cols; col++, pixel += CN)
+            grey[col] = lut[grey_value<T,CN>(pixel)];
+    }
+
+    return image_dst;
+}
+
+inline cv::Mat threshold(const cv::Mat &image_src, int threshold = 80)
+{
+    return dispatch_pixels(image_src, [&](const cv::Mat &image, auto format)
+    {
+        typedef decltype(format) F;
+        return threshold_kernel<typename F::type, F::channels>(image, threshold);
+    });
+}
+
+inline bool is_filled(const cv::Mat &image_src)
+{
+    return dispatch_pixels(image_src, [](const cv::Mat &image, auto format)
+    {
+        typedef decltype(format) F;
+        return is_filled_kernel<typename F::type, F::channels>(image);
+    });
+}
+
+inline float lightness(cv::Mat img)
+{
+    cv::Mat image = img;
+    if( image.empty() )
+    {
+        std::cout <<  "Could not open or find the image" << std::endl ;
+        return -1;
+    }
+
+    int64_t sum = dispatch_pixels(image, [](const cv::Mat &image, auto format)
+    {
+        typedef decltype(format) F;
+        return lightness_kernel<typename F::type, F::channels>(image);
+    });
+
+    float avg = (sum*1.0)/(image.cols*image.rows);
+
+    if(VERBOSE)
+        std::cout << "Lightness:\t\t" << avg << std::endl;
+
+    return avg;
+}
+
+inline float occupancy(cv::Mat img, int threshold)
+{
+    cv::Mat image = img;
+    if( image.empty() )
+    {
+        std::cout <<  "Could not open or find the image" << std::endl ;
+        return -1;
+    }
+
+    int pixels = dispatch_pixels(image, [&](const cv::Mat &image, auto format)
+    {
+        typedef decltype(format) F;
+        return occupancy_kernel<typename F::type, F::channels>(image, threshold);
+    });
+
+    float pct = (pixels*100.0)/(image.cols*image.rows);
+
+    if(VERBOSE)
+        std::cout << "occupancy (%):\t" << pct << std::endl;
+
+    return pct;
+}
+
+inline float similarity(cv::Mat img1, cv::Mat img2)
+{
+    if( img1.empty() || img2.empty())
+    {
+        std::cout <<  "Could not open or find the image" << std::endl ;
+        return -1;
+    }
+
+    auto equalized_grey = [](const cv::Mat &image, auto format)
+    {
+        typedef decltype(format) F;
+        return equalized_grey_kernel<typename F::type, F::channels>(image);
+    };
+    cv::Mat image1 = dispatch_pixels(img1, equalized_grey);
+    cv::Mat image2 = dispatch_pixels(img2, equalized_grey);
+
+    int64_t sum = 0;
+    for(int row = 0; row < image1.rows; row++)
+    {
+        const uchar *intensity1 = image1.ptr<uchar>(row);
+        const uchar *intensity2 = image2.ptr<uchar>(row);
+        for(int col = 0; col < image1.cols; col++)
+            sum += std::abs(intensity2[col]-intensity1[col]);
+    }
+    float pct = 100-((sum*100.0)/(255.0*image1.rows*image1.cols));
+
+    if(VERBOSE)
+        std::cout << "Similarity (%):\t" << pct << std::endl;
+
+    return pct;
+}
+
+#endif // DATASET_METRICS_HPP
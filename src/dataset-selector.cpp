@@ -10,6 +10,10 @@
 #include <regex>
 #include <experimental/filesystem>
 
+// Local includes
+#include "dataset-io.hpp"
+#include "dataset-metrics.hpp"
+
 #define VERBOSE false
 
 bool compare(const std::pair<float,cv::Mat>&i, const std::pair<float,cv::Mat>&j)
@@ -17,103 +21,6 @@ bool compare(const std::pair<float,cv::Mat>&i, const std::pair<float,cv::Mat>&j)
     return i.first > j.first;
 }
 
-float lightness(cv::Mat img)
-{
-    cv::Mat image = img;
-    if( image.empty() )
-    {
-        std::cout <<  "Could not open or find the image" << std::endl ;
-        return -1;
-    }
-
-    cv::cvtColor( image, image, cv::COLOR_BGR2GRAY );
-    cv::equalizeHist( image, image );
-
-    int pixels = 0;
-    int64_t sum = 0;
-    for(size_t row = 0; row < image.rows; row++)
-    {
-        for(size_t col = 0; col < image.cols; col++)
-        {
-            uchar intensity = image.at<uchar>(row,col);
-            sum += intensity;
-        }
-    }
-
-    float avg = (sum*1.0)/(image.cols*image.rows);
-
-    if(VERBOSE)
-        std::cout << "Lightness:\t\t" << avg << std::endl;
-
-    return avg;
-}
-
-float occupancy(cv::Mat img, int threshold)
-{
-    cv::Mat image = img;
-    if( image.empty() )
-    {
-        std::cout <<  "Could not open or find the image" << std::endl ;
-        return -1;
-    }
-
-    cv::cvtColor( image, image, cv::COLOR_BGR2GRAY );
-    //cv::equalizeHist( image, image );
-
-    int pixels = 0;
-    for(size_t row = 0; row < image.rows; row++)
-    {
-        for(size_t col = 0; col < image.cols; col++)
-        {
-            uchar intensity = image.at<uchar>(row,col);
-            if(intensity > threshold)
-                pixels++;
-        }
-    }
-
-    float pct = (pixels*100.0)/(image.cols*image.rows);
-
-    if(VERBOSE)
-        std::cout << "occupancy (%):\t" << pct << std::endl;
-
-    return pct;
-}
-
-float similarity(cv::Mat img1, cv::Mat img2)
-{
-    cv::Mat image1 = img1;
-    cv::Mat image2 = img2;
-    if( image1.empty() || image2.empty())
-    {
-        std::cout <<  "Could not open or find the image" << std::endl ;
-        return -1;
-    }
-
-    cv::cvtColor( image1, image1, cv::COLOR_BGR2GRAY );
-    cv::cvtColor( image2, image2, cv::COLOR_BGR2GRAY );
-    cv::equalizeHist( image1, image1 );
-    cv::equalizeHist( image2, image2 );
-
-    int sum = 0;
-    for(size_t row = 0; row < image1.rows; row++)
-    {
-        for(size_t col = 0; col < image1.cols; col++)
-        {
-            uchar intensity1 = image1.at<uchar>(row,col);
-            uchar intensity2 = image2.at<uchar>(row,col);
-
-            sum += std::abs(intensity2-intensity1);
-        }
-    }
-    float pct = 100-((sum*100.0)/(255*image1.rows*image1.cols));
-
-    if(VERBOSE)
-        std::cout << "Similarity (%):\t" << pct << std::endl;
-
-    return pct;
-}
-
-
 void selection_first(std::vector<cv::Mat> input_images, std::vector<cv::Mat> &output_images, int count)
 {
     output_images.clear();
@@ -200,7 +107,7 @@ void fetch_image_paths(std::string path, std::vector<std::string> &image_paths)
 
     // Generate vector of paths to supported files
     image_paths.clear();
-    std::vector<std::string> supported_file_extensions = {"jpg", "png"};
+    std::vector<std::string> supported_file_extensions = {"jpg", "png", "tif", "tiff"};
     for (const auto & entry : std::experimental::filesystem::directory_iterator(path))
     {
         std::string path_string = entry.path();
@@ -233,7 +140,8 @@ int main(int argc, char *argv[])
         std::cout << "1: Last image(s)" << std::endl;
         std::cout << "2: Middle image(s)" << std::endl;
         std::cout << "3: Random image(s)" << std::endl;
-        std::cout << "4: Best* image(s)" << std::endl;
+        std::cout << "4: Best* image(s)" << std::endl << std::endl;
+        std::cout << "Environment: DATASET_IO_DEPTH=<files in flight> (default " << IO_DEPTH << ")" << std::endl;
 
         return 0;
     }
@@ -274,6 +182,9 @@ int main(int argc, char *argv[])
 
         // Make decision
         std::vector<cv::Mat> image_sequence;
+        std::vector<std::vector<uchar>> image_batch;
+        std::vector<std::string> export_names;
+        std::vector<std::vector<uchar>> export_buffers;
 
         int max_value = image_paths.size();
         if(max_value%20)
@@ -286,7 +197,14 @@ int main(int argc, char *argv[])
         for(int i = 0; i < max_value; i++)
         {
             //std::cout << "Index: " << i << std::endl;
-            image_sequence.push_back(cv::imread(image_paths[i], cv::IMREAD_COLOR ));
+            if(!(i%IO_BATCH))
+            {
+                // Read the next batch of files with many requests in flight
+                int batch_end = std::min(i+IO_BATCH, max_value);
+                std::vector<std::string> batch_paths(image_paths.begin()+i, image_paths.begin()+batch_end);
+                read_files(batch_paths, image_batch, io_depth());
+            }
+            image_sequence.push_back(decode_image(image_batch[i%IO_BATCH], decode_flags(image_paths[i])));
 
             if(!((i+1)%20))
             {
@@ -328,12 +246,22 @@ int main(int argc, char *argv[])
                     char index_padded[25];
                     sprintf(index_padded, "%05d", export_index);
                     std::string image_name = category_dir_selected+"/image_"+index_padded+".png";
-                    cv::imwrite(image_name, image_selection[i]);
+                    export_names.push_back(image_name);
+                    export_buffers.emplace_back();
+                    encode_image(image_name, image_selection[i], export_buffers.back());
                     export_index++;
                 }
 
                 image_sequence.clear();
             }
+
+            // Write selections in batches
+            if(export_names.size() >= IO_BATCH || i+1 == max_value)
+            {
+                write_files(export_names, export_buffers, io_depth());
+                export_names.clear();
+                export_buffers.clear();
+            }
         }
     }
 
@@ -0,0 +1,512 @@
+// OpenCV includes
+#include <opencv2/opencv.hpp>
+#include <opencv2/core.hpp>
+
+// Standard includes
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <map>
+#include <array>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <experimental/filesystem>
+
+// Local includes
+#include "dataset-io.hpp"
+#include "dataset-metrics.hpp"
+
+// Defines
+#define VERBOSE false
+#define GROUP_SIZE 20       // Sequence length used by dataset-selector
+#define HIST_BINS 20
+#define CHOP_SIZE 224       // Tile size used by dataset-chopper
+#define CHOP_THRESHOLD 80
+
+#if IO_BATCH % GROUP_SIZE
+#error "IO_BATCH must be a multiple of GROUP_SIZE"
+#endif
+
+/*
+ * Counters of one category, as metric -> key -> count. Plain counters use an
+ * empty key, histograms use the zero-padded bin index (edges are written
+ * once per report) and resolutions use "<width>x<height>". Counters merge
+ * by summing; the selector group counts depend on the category total and
+ * are derived again after merging.
+ */
+typedef std::map<std::string, std::map<std::string, long>> category_stats;
+typedef std::map<std::string, category_stats> dataset_stats;
+
+// Histograms and the value range they cover
+const std::map<std::string, float> histogram_ranges = {{"lightness", 256}, {"occupancy", 100}, {"similarity", 100}};
+
+void merge_stats(category_stats &dst, const category_stats &src)
+{
+    for(const auto &metric : src)
+        for(const auto &entry : metric.second)
+            dst[metric.first][entry.first] += entry.second;
+}
+
+void merge_stats(dataset_stats &dst, const dataset_stats &src)
+{
+    for(const auto &category : src)
+        merge_stats(dst[category.first], category.second);
+}
+
+bool is_derived_metric(const std::string &metric)
+{
+    return metric == "selector_groups" || metric == "selector_truncated";
+}
+
+// Groups the selector forms and images it ignores, from the (merged) file count
+void update_derived_stats(dataset_stats &stats)
+{
+    for(auto &category : stats)
+    {
+        long files = category.second["files"][""];
+        category.second["selector_groups"][""] = files/GROUP_SIZE;
+        category.second["selector_truncated"][""] = files%GROUP_SIZE;
+    }
+}
+
+std::string histogram_bin(float value, float max_value)
+{
+    int bin = value*HIST_BINS/max_value;
+    bin = std::max(0, std::min(HIST_BINS-1, bin));
+
+    char key[8];
+    sprintf(key, "%02d", bin);
+    return key;
+}
+
+float histogram_edge(const std::string &metric, int bin)
+{
+    return bin*histogram_ranges.at(metric)/HIST_BINS;
+}
+
+void fetch_image_paths(std::string path, std::vector<std::string> &image_paths)
+{
+    if(VERBOSE)
+        std::cout << "Dataset path \"" << path << "\"..." << std::endl;
+
+    // Generate vector of paths to supported files
+    image_paths.clear();
+    std::vector<std::string> supported_file_extensions = {"jpg", "png", "tif", "tiff"};
+    for (const auto & entry : std::experimental::filesystem::directory_iterator(path))
+    {
+        std::string path_string = entry.path();
+        std::string file_extension = path_string.substr(path_string.find_last_of(".") + 1);
+
+        for(const auto & supported_file_extension : supported_file_extensions)
+        {
+            if(file_extension == supported_file_extension)
+            {
+                image_paths.push_back(path_string);
+                break;
+            }
+        }
+    }
+
+    if(VERBOSE)
+        std::cout << "Found " << image_paths.size() << " image(s)!" << std::endl;
+}
+
+typedef std::shared_ptr<std::vector<std::string>> batch_paths;
+typedef std::shared_ptr<std::vector<std::vector<uchar>>> batch_buffers;
+
+// One selector group of a batch, so a worker holds at most two decoded images
+struct group_task
+{
+    std::string category;
+    batch_paths paths;
+    batch_buffers buffers;
+    size_t begin = 0;
+    size_t end = 0;
+};
+
+// Bounded queue between the reading thread and the profiling workers
+struct task_queue
+{
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<group_task> tasks;
+    size_t capacity = 1;
+    bool closed = false;
+
+    void push(group_task task)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&]() { return tasks.size() < capacity; });
+        tasks.push_back(std::move(task));
+        changed.notify_all();
+    }
+
+    // Returns false once the queue is closed and empty
+    bool pop(group_task &task)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&]() { return !tasks.empty() || closed; });
+        if(tasks.empty())
+            return false;
+        task = std::move(tasks.front());
+        tasks.pop_front();
+        changed.notify_all();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        changed.notify_all();
+    }
+};
+
+// Input pixel type as "<depth>C<channels>", e.g. "16UC3"
+std::string pixel_format_name(const cv::Mat &image)
+{
+    const std::array<std::string,8> depth_names = {"8U", "8S", "16U", "16S", "32S", "32F", "64F", "16F"};
+    std::string depth_name = image.depth() < depth_names.size() ? depth_names[image.depth()] : std::to_string(image.depth());
+    return depth_name+"C"+std::to_string(image.channels());
+}
+
+// Profile one image. Previous is the preceding image of the same selector group (or empty).
+void profile_image(const cv::Mat &image, const cv::Mat &previous, category_stats &stats)
+{
+    if(image.empty())
+    {
+        stats["unreadable"][""]++;
+        return;
+    }
+
+    stats["images"][""]++;
+    stats["resolution"][std::to_string(image.cols)+"x"+std::to_string(image.rows)]++;
+    stats["pixel_format"][pixel_format_name(image)]++;
+    stats["occupancy"][histogram_bin(occupancy(image, 0), histogram_ranges.at("occupancy"))]++;
+    stats["lightness"][histogram_bin(lightness(image), histogram_ranges.at("lightness"))]++;
+
+    if(!previous.empty() && previous.size() == image.size())
+        stats["similarity"][histogram_bin(similarity(previous, image), histogram_ranges.at("similarity"))]++;
+
+    // Frames and tiles the chopper would reject
+    cv::Mat image_th = threshold(image, CHOP_THRESHOLD);
+    if(!is_filled(image_th))
+        stats["unfilled"][""]++;
+
+    for(int row = 0; row < image.rows/CHOP_SIZE; row++)
+    {
+        for(int col = 0; col < image.cols/CHOP_SIZE; col++)
+        {
+            cv::Rect image_roi(col*CHOP_SIZE, row*CHOP_SIZE, CHOP_SIZE, CHOP_SIZE);
+            if(is_filled(image_th(image_roi)))
+                stats["chop_tiles_kept"][""]++;
+            else
+                stats["chop_tiles_rejected"][""]++;
+        }
+    }
+}
+
+// Worker loop: decode and profile groups until the queue is closed
+void profile_worker(task_queue &queue, dataset_stats &stats)
+{
+    group_task task;
+    while(queue.pop(task))
+    {
+        cv::Mat previous;
+        for(size_t i = task.begin; i < task.end; i++)
+        {
+            cv::Mat image = decode_image((*task.buffers)[i], decode_flags((*task.paths)[i]));
+            profile_image(image, previous, stats[task.category]);
+            previous = image;
+        }
+    }
+}
+
+batch_buffers read_batch(batch_paths paths)
+{
+    batch_buffers buffers = std::make_shared<std::vector<std::vector<uchar>>>();
+    read_files(*paths, *buffers, io_depth());
+    return buffers;
+}
+
+// Quote a CSV field if it could be misread (RFC 4180 style)
+std::string csv_field(const std::string &value)
+{
+    if(value.find_first_of(",\"\r\n") == std::string::npos && (value.empty() || value[0] != '#'))
+        return value;
+
+    std::string quoted = "\"";
+    for(char c : value)
+        quoted += (c == '"') ? std::string("\"\"") : std::string(1, c);
+    return quoted + "\"";
+}
+
+// Read one CSV record, which may span lines inside quotes
+bool read_csv_record(std::istream &stream, std::vector<std::string> &fields)
+{
+    fields.assign(1, "");
+    bool quoted = false;
+    char c;
+    if(stream.peek() == EOF)
+        return false;
+
+    while(stream.get(c))
+    {
+        if(quoted)
+        {
+            if(c != '"')
+                fields.back() += c;
+            else if(stream.peek() == '"')
+                fields.back() += char(stream.get());
+            else
+                quoted = false;
+        }
+        else if(c == '"')
+            quoted = true;
+        else if(c == ',')
+            fields.emplace_back();
+        else if(c == '\n')
+            break;
+        else if(c != '\r')
+            fields.back() += c;
+    }
+    return true;
+}
+
+std::string json_string(const std::string &value)
+{
+    std::string escaped = "\"";
+    for(unsigned char c : value)
+    {
+        if(c == '"' || c == '\\')
+        {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if(c < 0x20)
+        {
+            char code[8];
+            sprintf(code, "\\u%04x", c);
+            escaped += code;
+        }
+        else
+            escaped += c;
+    }
+    return escaped + "\"";
+}
+
+bool load_report(const std::string &path, dataset_stats &stats)
+{
+    std::ifstream file(path);
+    if(!file)
+    {
+        std::cout << "Could not open report \"" << path << "\"" << std::endl;
+        return false;
+    }
+
+    // Format: category,metric,key,count (comment lines and header first)
+    std::string line;
+    while(std::getline(file, line) && !line.empty() && line[0] == '#')
+        continue;
+    if(!line.empty() && line.back() == '\r')
+        line.pop_back();
+    if(line != "category,metric,key,count")
+    {
+        std::cout << "Not a dataset-stats CSV report: \"" << path << "\"" << std::endl;
+        return false;
+    }
+
+    // Merge only once the whole report parsed
+    dataset_stats report;
+    std::vector<std::string> fields;
+    int record = 1;
+    while(read_csv_record(file, fields))
+    {
+        record++;
+        if(fields.size() == 1 && fields[0].empty())
+            continue;
+
+        long count = 0;
+        size_t parsed = 0;
+        try
+        {
+            if(fields.size() == 4)
+                count = std::stol(fields[3], &parsed);
+        }
+        catch(const std::exception &)
+        {
+            parsed = 0;
+        }
+        if(fields.size() != 4 || parsed == 0 || parsed != fields[3].size())
+        {
+            std::cout << "Bad record " << record << " in report \"" << path << "\"" << std::endl;
+            return false;
+        }
+
+        const std::string &metric = fields[1];
+        if(!is_derived_metric(metric))
+            report[fields[0]][metric][fields[2]] += count;
+    }
+
+    merge_stats(stats, report);
+    return true;
+}
+
+void write_csv(const std::string &path, const dataset_stats &stats)
+{
+    std::ofstream file(path);
+    for(const auto &histogram : histogram_ranges)
+    {
+        file << "# " << histogram.first << " bin lower edges:";
+        for(int bin = 0; bin < HIST_BINS; bin++)
+            file << " " << histogram_edge(histogram.first, bin);
+        file << std::endl;
+    }
+    file << "category,metric,key,count" << std::endl;
+    for(const auto &category : stats)
+        for(const auto &metric : category.second)
+            for(const auto &entry : metric.second)
+                file << csv_field(category.first) << "," << csv_field(metric.first) << "," << csv_field(entry.first) << "," << entry.second << std::endl;
+}
+
+void write_json(const std::string &path, const dataset_stats &stats)
+{
+    std::ofstream file(path);
+    file << "{\n  \"bins\": {";
+    for(auto histogram = histogram_ranges.begin(); histogram != histogram_ranges.end(); histogram++)
+    {
+        file << (histogram == histogram_ranges.begin() ? "\n" : ",\n") << "    \"" << histogram->first << "\": [";
+        for(int bin = 0; bin < HIST_BINS; bin++)
+            file << (bin ? ", " : "") << histogram_edge(histogram->first, bin);
+        file << "]";
+    }
+    file << "\n  },\n  \"categories\": {";
+    for(auto category = stats.begin(); category != stats.end(); category++)
+    {
+        file << (category == stats.begin() ? "\n" : ",\n") << "    " << json_string(category->first) << ": {";
+        for(auto metric = category->second.begin(); metric != category->second.end(); metric++)
+        {
+            file << (metric == category->second.begin() ? "\n" : ",\n") << "      " << json_string(metric->first) << ": ";
+
+            // Plain counters are written as numbers, everything else as objects
+            if(metric->second.size() == 1 && metric->second.begin()->first.empty())
+            {
+                file << metric->second.begin()->second;
+                continue;
+            }
+
+            file << "{";
+            for(auto entry = metric->second.begin(); entry != metric->second.end(); entry++)
+                file << (entry == metric->second.begin() ? "" : ", ") << json_string(entry->first) << ": " << entry->second;
+            file << "}";
+        }
+        file << "\n    }";
+    }
+    file << "\n  }\n}" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    // Receive input
+    if(argc != 2 && argc != 3)
+    {
+        std::cout << "Usage:" << std::endl;
+        std::cout << "Command: ./dataset-stats <dataset path> [report to merge]" << std::endl;
+        std::cout << "Writes <dataset path>_stats.csv and <dataset path>_stats.json." << std::endl;
+        std::cout << "A previous .csv report is added to the new counts." << std::endl;
+        std::cout << "Environment: DATASET_IO_DEPTH=<files in flight> (default " << IO_DEPTH << ")" << std::endl;
+
+        return 0;
+    }
+
+    std::string arg_path(argv[1]);
+    std::cout << "Dataset: " << arg_path << std::endl;
+
+    // Remove last slash
+    char last_char = arg_path[arg_path.length()-1];
+    if(last_char == '/')
+         arg_path = arg_path.substr(0, arg_path.length() - 1);
+
+    dataset_stats stats;
+    if(argc == 3 && !load_report(argv[2], stats))
+        return 1;
+
+    int thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+    // List all batches first, so the next one can be read while the current one is profiled
+    std::vector<std::pair<std::string, batch_paths>> batches;
+    for (const auto & entry : std::experimental::filesystem::directory_iterator(arg_path))
+    {
+        std::string path_string = entry.path();
+
+        int slash_index_dir = path_string.find_last_of("\\/")+1;
+        std::string category_dir_name = path_string.substr(slash_index_dir,path_string.length()-slash_index_dir);
+
+        if(VERBOSE)
+            std::cout << "Scanning category: " << category_dir_name << std::endl;
+
+        // Fetch all images of directory (alphabetically)
+        std::vector<std::string> image_paths;
+        fetch_image_paths(path_string,image_paths);
+        std::sort(image_paths.begin(), image_paths.end());
+
+        stats[category_dir_name]["files"][""] += image_paths.size();
+
+        for(size_t batch_start = 0; batch_start < image_paths.size(); batch_start += IO_BATCH)
+        {
+            size_t batch_end = std::min<size_t>(batch_start+IO_BATCH, image_paths.size());
+            batch_paths paths = std::make_shared<std::vector<std::string>>(image_paths.begin()+batch_start, image_paths.begin()+batch_end);
+            batches.push_back(std::make_pair(category_dir_name, paths));
+        }
+    }
+
+    // Single streaming pass: one persistent pool profiles groups while the
+    // main thread prefetches the next batch of compressed files
+    task_queue queue;
+    queue.capacity = 2*IO_BATCH/GROUP_SIZE;
+    std::vector<dataset_stats> thread_stats(thread_count);
+    std::vector<std::thread> workers;
+    for(int t = 0; t < thread_count; t++)
+        workers.emplace_back(profile_worker, std::ref(queue), std::ref(thread_stats[t]));
+
+    std::future<batch_buffers> prefetch;
+    if(!batches.empty())
+        prefetch = std::async(std::launch::async, read_batch, batches[0].second);
+    for(size_t b = 0; b < batches.size(); b++)
+    {
+        batch_buffers buffers = prefetch.get();
+        if(b+1 < batches.size())
+            prefetch = std::async(std::launch::async, read_batch, batches[b+1].second);
+
+        for(size_t begin = 0; begin < buffers->size(); begin += GROUP_SIZE)
+        {
+            group_task task;
+            task.category = batches[b].first;
+            task.paths = batches[b].second;
+            task.buffers = buffers;
+            task.begin = begin;
+            task.end = std::min<size_t>(begin+GROUP_SIZE, buffers->size());
+            queue.push(std::move(task));
+        }
+    }
+
+    queue.close();
+    for(auto &worker : workers)
+        worker.join();
+    for(const auto &partial : thread_stats)
+        merge_stats(stats, partial);
+
+    update_derived_stats(stats);
+    write_csv(arg_path + "_stats.csv", stats);
+    write_json(arg_path + "_stats.json", stats);
+    std::cout << "Report: " << arg_path << "_stats.{csv,json}" << std::endl;
+
+    std::cout << "End of main!" << std::endl;
+    return 0;
+}